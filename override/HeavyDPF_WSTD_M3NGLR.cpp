@@ -0,0 +1,592 @@
+/**
+ * Copyright (c) Wasted Audio 2023 - GPL-3.0-or-later
+ */
+
+#include "HeavyDPF_WSTD_M3NGLR.hpp"
+#include "WstdConfig.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if WSTD_META_DISABLE_DENORMALS
+#include "extra/ScopedDenormalDisable.hpp"
+#endif
+
+
+// Heavy message pool and queue sizes in KB, set at build time with `make POOL_KB=.. IN_QUEUE_KB=..`.
+// The WSTD_M3NGLR_POOL_KB and WSTD_M3NGLR_IN_QUEUE_KB environment variables override them per process.
+// Nothing checks smaller sizes against the patch: run the heaviest session with WSTD_M3NGLR_MEMREPORT
+// set and size them from the reported peaks. An exhausted pool asserts inside Heavy, refused queue
+// messages are retried on the next block.
+#ifndef WSTD_M3NGLR_POOL_KB
+#define WSTD_M3NGLR_POOL_KB 10
+#endif
+
+#ifndef WSTD_M3NGLR_IN_QUEUE_KB
+#define WSTD_M3NGLR_IN_QUEUE_KB 2
+#endif
+
+// The patch has no outgoing parameters or MIDI, nothing is ever queued for the host.
+#ifndef WSTD_M3NGLR_OUT_QUEUE_KB
+#define WSTD_M3NGLR_OUT_QUEUE_KB 0
+#endif
+
+// Level (about -140dBFS) below which input and output count as digital silence.
+#define WSTD_SILENCE_THRESHOLD 1e-7f
+
+// Minimum time the input has to be silent before processing stops, in seconds.
+// Covers the crossover ringing and the limiter and smoother releases in manglr_st.
+#define WSTD_TAIL_TIME 0.5
+
+// Length of each half of the fade around a discontinuous parameter change, in seconds.
+#define WSTD_FADE_TIME 0.003
+
+// Change, as a fraction of the parameter range, from which a continuous parameter counts as a jump.
+// Logarithmic parameters are measured on their log scale, the way their knobs move.
+#define WSTD_FADE_JUMP 0.1f
+
+// Number of parameters that have to jump in the same block before the output is faded.
+// A preset load or state restore changes many at once, a single switch or knob flick does not.
+#define WSTD_FADE_MIN_JUMPS 3
+
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// Heavy hooks
+
+static void hvPrintHookFunc(HeavyContextInterface *c, const char *printLabel, const char *msgString, const HvMessage *m)
+{
+    d_stdout("> %s %s", printLabel, msgString);
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Heavy keeps the message pool fill level to itself. The pool lives in the message queue and only
+// grows into its buffer, so it is also the high-water mark of this context.
+
+class HeavyUsageContext : public Heavy_WSTD_M3NGLR
+{
+public:
+    using Heavy_WSTD_M3NGLR::Heavy_WSTD_M3NGLR;
+
+    uint32_t getPoolUsage() const noexcept
+    {
+        return static_cast<uint32_t>(mq.mp.bufferIndex);
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+struct ObjectInfo {
+    const char* name;
+    const char* type;
+    size_t size;
+};
+
+// Every object of the generated context, see tools/plugin_meta.py.
+static const ObjectInfo kObjectInfo[] = {
+    WSTD_META_OBJECTS
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+static bool isSilentBlock(const float* buffer, uint32_t frames) noexcept
+{
+    for (uint32_t i = 0; i < frames; ++i)
+    {
+        if (std::fabs(buffer[i]) > WSTD_SILENCE_THRESHOLD)
+            return false;
+    }
+
+    return true;
+}
+
+static int getEnvKb(const char* name, int fallback)
+{
+    if (const char* const value = std::getenv(name))
+    {
+        const int kb = std::atoi(value);
+
+        if (kb > 0)
+            return kb;
+
+        d_stderr("%s=%s is not a valid size, using %d KB", name, value, fallback);
+    }
+
+    return fallback;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+// Receivers, parameter ranges and units come from the patch, see tools/plugin_meta.py.
+static const hv_uint32_t kReceiverHashes[HeavyDPF_WSTD_M3NGLR::paramCount] = {
+    WSTD_META_RECEIVERS
+};
+
+struct ParameterInfo {
+    const char* name;
+    const char* symbol;
+    const char* unit;
+    uint32_t hints;
+    float min;
+    float max;
+    float def;
+};
+
+static const ParameterInfo kParameterInfo[HeavyDPF_WSTD_M3NGLR::paramCount] = {
+    WSTD_META_PARAMETERS
+};
+
+static_assert(HeavyDPF_WSTD_M3NGLR::paramCount <= 32, "parameter changes are tracked in a 32-bit mask");
+
+// Parameters that switch instead of sweep, any change reorders or toggles part of a band chain.
+static const uint32_t kSteppedParameters =
+    1u << HeavyDPF_WSTD_M3NGLR::paramHigh_Lmtr | 1u << HeavyDPF_WSTD_M3NGLR::paramHigh_Sqnc |
+    1u << HeavyDPF_WSTD_M3NGLR::paramLow_Lmtr  | 1u << HeavyDPF_WSTD_M3NGLR::paramLow_Sqnc  |
+    1u << HeavyDPF_WSTD_M3NGLR::paramMid_Lmtr  | 1u << HeavyDPF_WSTD_M3NGLR::paramMid_Sqnc;
+
+// The three Sqnc parameters share one list, tools/plugin_meta.py checks the JSON agrees.
+static const char* const kSqncList[] = {
+    WSTD_META_ENUM_High_Sqnc
+};
+
+static_assert(WSTD_META_ENUM_High_Sqnc_COUNT == WSTD_META_ENUM_Mid_Sqnc_COUNT &&
+              WSTD_META_ENUM_High_Sqnc_COUNT == WSTD_META_ENUM_Low_Sqnc_COUNT, "Sqnc parameters share one list");
+
+// Position of a value within the parameter range, from 0 to 1.
+static float normalizedValue(const ParameterInfo& info, float value) noexcept
+{
+    value = std::max(info.min, std::min(info.max, value));
+
+    if (info.hints & kParameterIsLogarithmic)
+        return std::log(value / info.min) / std::log(info.max / info.min);
+
+    return (value - info.min) / (info.max - info.min);
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Main DPF plugin class
+
+HeavyDPF_WSTD_M3NGLR::HeavyDPF_WSTD_M3NGLR()
+    : Plugin(paramCount, programCount, 0)
+{
+    for (uint32_t i = 0; i < paramCount; ++i)
+        _parameters[i] = _appliedParameters[i] = kParameterInfo[i].def;
+
+    _poolKb = getEnvKb("WSTD_M3NGLR_POOL_KB", WSTD_M3NGLR_POOL_KB);
+    _inQueueKb = getEnvKb("WSTD_M3NGLR_IN_QUEUE_KB", WSTD_M3NGLR_IN_QUEUE_KB);
+    _memoryReport = std::getenv("WSTD_M3NGLR_MEMREPORT") != nullptr;
+
+    _context = nullptr;
+    initContext(getSampleRate());
+
+    WSTD_TRACE_INIT();
+}
+
+HeavyDPF_WSTD_M3NGLR::~HeavyDPF_WSTD_M3NGLR()
+{
+    if (_memoryReport)
+        printUsageReport();
+
+    delete _context;
+
+    WSTD_TRACE_RELEASE();
+}
+
+void HeavyDPF_WSTD_M3NGLR::initContext(double sampleRate)
+{
+    if (_context != nullptr && _memoryReport)
+        printUsageReport();
+
+    delete _context;
+
+    _context = new HeavyUsageContext(sampleRate, _poolKb, _inQueueKb, WSTD_M3NGLR_OUT_QUEUE_KB);
+    _context->setUserData(this);
+    _context->setPrintHook(&hvPrintHookFunc);
+
+    _peakMessages = 0;
+    _refusedMessages = 0;
+
+    if (_memoryReport)
+        printMemoryReport(sampleRate);
+
+    // ensure that the new context has the current parameters, whatever did not fit is sent next block
+    _pendingParameters = 0;
+    _pendingSnapshot = false;
+    _heldSnapshot = false;
+    _unsentParameters = ~0u >> (32 - paramCount);
+    _heldParameters = sendParameters(_unsentParameters);
+    _fadeState = kFadeIdle;
+    _fadeFrames = std::max<uint32_t>(8, uint32_t(sampleRate * WSTD_FADE_TIME) & ~7u);
+    _fadeRemaining = 0;
+
+    _tailFrames = uint32_t(sampleRate * WSTD_TAIL_TIME);
+    _silentFrames = 0;
+    _asleep = false;
+}
+
+/**
+   Print what one instance costs in memory, each time a context is created.
+   The Heavy context size covers the message pool, the queues and everything the objects allocate,
+   such as tables and delay lines. The objects' own state is listed below it, largest first.
+*/
+void HeavyDPF_WSTD_M3NGLR::printMemoryReport(double sampleRate) const
+{
+    const int contextSize = _context->getSize();
+    const int poolSize = _poolKb * 1024;
+    const int inQueueSize = _inQueueKb * 1024;
+    const int outQueueSize = WSTD_M3NGLR_OUT_QUEUE_KB * 1024;
+
+    d_stdout("WSTD_M3NGLR memory per instance at %.0f Hz:", sampleRate);
+    d_stdout("  heavy context     %8d bytes, of which", contextSize);
+    d_stdout("    message pool    %8d bytes", poolSize);
+    d_stdout("    input queue     %8d bytes", inQueueSize);
+    d_stdout("    output queue    %8d bytes", outQueueSize);
+    d_stdout("    object buffers  %8d bytes (tables, delay lines and the rest)",
+             contextSize - poolSize - inQueueSize - outQueueSize);
+    d_stdout("  plugin            %8d bytes", static_cast<int>(sizeof(*this)));
+
+    std::vector<ObjectInfo> objects(kObjectInfo, kObjectInfo + sizeof(kObjectInfo) / sizeof(kObjectInfo[0]));
+    std::stable_sort(objects.begin(), objects.end(), [](const ObjectInfo& a, const ObjectInfo& b) {
+        return a.size > b.size;
+    });
+
+    size_t objectsSize = 0;
+    for (const ObjectInfo& object : objects)
+        objectsSize += object.size;
+
+    d_stdout("  object state      %8d bytes in %d objects", static_cast<int>(objectsSize), static_cast<int>(objects.size()));
+    for (const ObjectInfo& object : objects)
+        d_stdout("    %-24s %-20s %6d bytes", object.name, object.type, static_cast<int>(object.size));
+}
+
+/**
+   Print how much of the pool and input queue the context actually needed, before it is destroyed.
+*/
+void HeavyDPF_WSTD_M3NGLR::printUsageReport() const
+{
+    const uint32_t poolUsage = static_cast<const HeavyUsageContext*>(_context)->getPoolUsage();
+
+    d_stdout("WSTD_M3NGLR usage of this context:");
+    d_stdout("  message pool    %8u of %d bytes", poolUsage, _poolKb * 1024);
+    d_stdout("  input queue     %8u messages per block at most, %u refused", _peakMessages, _refusedMessages);
+}
+
+void HeavyDPF_WSTD_M3NGLR::initParameter(uint32_t index, Parameter& parameter)
+{
+    DISTRHO_SAFE_ASSERT_RETURN(index < paramCount,);
+
+    const ParameterInfo& info(kParameterInfo[index]);
+
+    parameter.name = info.name;
+    parameter.symbol = info.symbol;
+    parameter.unit = info.unit;
+    parameter.hints = kParameterIsAutomatable | info.hints;
+    parameter.ranges.min = info.min;
+    parameter.ranges.max = info.max;
+    parameter.ranges.def = info.def;
+
+    switch (index)
+    {
+        case paramHigh_Sqnc:
+        case paramLow_Sqnc:
+        case paramMid_Sqnc:
+            if (ParameterEnumerationValue *values = new ParameterEnumerationValue[WSTD_META_ENUM_High_Sqnc_COUNT])
+            {
+                parameter.enumValues.restrictedMode = true;
+                for (int i = 0; i < WSTD_META_ENUM_High_Sqnc_COUNT; ++i)
+                {
+                    values[i].value = float(i);
+                    values[i].label = kSqncList[i];
+                }
+                parameter.enumValues.count = WSTD_META_ENUM_High_Sqnc_COUNT;
+                parameter.enumValues.values = values;
+            }
+            break;
+    }
+}
+
+void HeavyDPF_WSTD_M3NGLR::initProgramName(uint32_t index, String& programName)
+{
+    switch (index)
+    {
+        case programDefault:
+            programName = "Default";
+            break;
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Internal data
+
+float HeavyDPF_WSTD_M3NGLR::getParameterValue(uint32_t index) const
+{
+    DISTRHO_SAFE_ASSERT_RETURN(index < paramCount, 0.0f);
+
+    return _parameters[index];
+}
+
+void HeavyDPF_WSTD_M3NGLR::setParameterValue(uint32_t index, float value)
+{
+    DISTRHO_SAFE_ASSERT_RETURN(index < paramCount,);
+
+    // The context only sees the change at the next block, together with every other
+    // change made before it. A preset load arrives as one snapshot instead of 25 steps.
+    _parameters[index] = value;
+    _pendingParameters.fetch_or(1u << index);
+}
+
+/**
+   Load a program as one snapshot.
+   Every parameter is queued for the next block, together with the request to fade,
+   so the whole state changes at once under the fade whatever the values are.
+*/
+void HeavyDPF_WSTD_M3NGLR::loadProgram(uint32_t index)
+{
+    DISTRHO_SAFE_ASSERT_RETURN(index < programCount,);
+
+    for (uint32_t i = 0; i < paramCount; ++i)
+        _parameters[i] = kParameterInfo[i].def;
+
+    _pendingParameters.fetch_or(~0u >> (32 - paramCount));
+    _pendingSnapshot = true;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Process
+
+/**
+   Check if the changed parameters form a snapshot that would make an audible step.
+   A stepped parameter counts as a jump on any change, a continuous one only on a large one.
+   Only several jumps at once (a preset change, a state restore) are faded, automation of
+   a single switch and knob drags go straight through.
+*/
+bool HeavyDPF_WSTD_M3NGLR::needsFade(uint32_t changed) const noexcept
+{
+    uint32_t jumps = 0;
+
+    for (uint32_t i = 0; i < paramCount; ++i)
+    {
+        if ((changed & (1u << i)) == 0 || _parameters[i] == _appliedParameters[i])
+            continue;
+
+        const ParameterInfo& info(kParameterInfo[i]);
+
+        if ((kSteppedParameters & (1u << i)) != 0 ||
+            std::fabs(normalizedValue(info, _parameters[i]) - normalizedValue(info, _appliedParameters[i])) > WSTD_FADE_JUMP)
+            ++jumps;
+    }
+
+    return jumps >= WSTD_FADE_MIN_JUMPS;
+}
+
+/**
+   Send the changed parameters to the context, values the context already has are skipped.
+   Returns the ones the input queue had no room for, they stay held and are sent again next block.
+*/
+uint32_t HeavyDPF_WSTD_M3NGLR::sendParameters(uint32_t changed)
+{
+    WSTD_TRACE_INSTANT("snapshot", changed, 0.0f);
+
+    uint32_t failed = 0;
+    uint32_t sent = 0;
+
+    for (uint32_t i = 0; i < paramCount; ++i)
+    {
+        if ((changed & (1u << i)) == 0)
+            continue;
+
+        const float value = _parameters[i];
+
+        if (value == _appliedParameters[i] && (_unsentParameters & (1u << i)) == 0)
+            continue;
+
+        if (_context->sendFloatToReceiver(kReceiverHashes[i], value))
+        {
+            WSTD_TRACE_INSTANT(kParameterInfo[i].symbol, i, value);
+
+            _appliedParameters[i] = value;
+            _unsentParameters &= ~(1u << i);
+            ++sent;
+        }
+        else
+        {
+            failed |= 1u << i;
+            ++_refusedMessages;
+        }
+    }
+
+    // the context empties its input queue at the start of every process call
+    _peakMessages = std::max(_peakMessages, sent);
+
+    return failed;
+}
+
+/**
+   Apply the fade gain ramp to the next `ramp` frames from `offset`.
+   A block that can not be split at the end of the ramp is processed whole, the rest of it
+   holds the final gain: silence after a fade out, unchanged after a fade in.
+*/
+void HeavyDPF_WSTD_M3NGLR::applyFade(float** outputs, uint32_t offset, uint32_t ramp, uint32_t frames) noexcept
+{
+    const float step = 1.0f / _fadeFrames;
+    float gain = _fadeState == kFadeOut
+               ? (_fadeRemaining - 1) * step
+               : (_fadeFrames - _fadeRemaining) * step;
+    const float delta = _fadeState == kFadeOut ? -step : step;
+
+    for (uint32_t i = offset; i < offset + ramp; ++i)
+    {
+        outputs[0][i] *= gain;
+        outputs[1][i] *= gain;
+        gain += delta;
+    }
+
+    if (_fadeState == kFadeOut)
+    {
+        std::memset(outputs[0] + offset + ramp, 0, sizeof(float) * (frames - ramp));
+        std::memset(outputs[1] + offset + ramp, 0, sizeof(float) * (frames - ramp));
+    }
+}
+
+// The audio thread only records into the trace ring claimed here, for as long as the plugin is active.
+void HeavyDPF_WSTD_M3NGLR::activate()
+{
+    WSTD_TRACE_CLAIM();
+}
+
+void HeavyDPF_WSTD_M3NGLR::deactivate()
+{
+    WSTD_TRACE_RELEASE();
+}
+
+void HeavyDPF_WSTD_M3NGLR::run(const float** inputs, float** outputs, uint32_t frames)
+{
+#if WSTD_META_DISABLE_DENORMALS
+    const ScopedDenormalDisable sdd;
+#endif
+    WSTD_TRACE_SCOPE("run", frames);
+
+    // Silent input: keep processing until the band chains have rung out, then stop calling into
+    // the context altogether. Parameter changes stay pending until the input comes back.
+    const bool silentInput = isSilentBlock(inputs[0], frames) && isSilentBlock(inputs[1], frames);
+
+    if (! silentInput)
+    {
+        if (_asleep)
+        {
+            // the context state is silent, changes made meanwhile need no fade
+            _pendingSnapshot = false;
+            _heldSnapshot = false;
+            _heldParameters = sendParameters(_heldParameters | _pendingParameters.exchange(0));
+            _asleep = false;
+
+            WSTD_TRACE_INSTANT("wake", 0, 0.0f);
+        }
+
+        _silentFrames = 0;
+    }
+    else if (_asleep)
+    {
+        std::memset(outputs[0], 0, sizeof(float) * frames);
+        std::memset(outputs[1], 0, sizeof(float) * frames);
+        return;
+    }
+    else
+    {
+        _silentFrames = std::min(_silentFrames + frames, _tailFrames);
+    }
+
+    // the snapshot flag is set after its parameters, take it first
+    if (_pendingSnapshot.exchange(false))
+    {
+        _heldSnapshot = true;
+
+        WSTD_TRACE_INSTANT("program", 0, 0.0f);
+    }
+
+    _heldParameters |= _pendingParameters.exchange(0);
+
+    if (_fadeState == kFadeIdle && _heldParameters != 0)
+    {
+        if (_heldSnapshot || needsFade(_heldParameters))
+        {
+            _fadeState = kFadeOut;
+            _fadeRemaining = _fadeFrames;
+            _heldSnapshot = false;
+
+            WSTD_TRACE_INSTANT("fade", _heldParameters, 0.0f);
+        }
+        else
+        {
+            _heldParameters = sendParameters(_heldParameters);
+        }
+    }
+
+    // Fade out on the old state, apply all held changes at once, fade back in on the new one.
+    // Heavy only processes whole SIMD vectors, the fade length is a multiple of them, so only the
+    // last chunk of a block can be odd-sized. A fade boundary off the vector grid is not split at,
+    // the change then waits for the next block.
+    for (uint32_t offset = 0; offset < frames;)
+    {
+        uint32_t chunk = frames - offset;
+
+        if (_fadeState != kFadeIdle && _fadeRemaining < chunk && (_fadeRemaining & 7) == 0)
+            chunk = _fadeRemaining;
+
+        const float* chunkInputs[2] = { inputs[0] + offset, inputs[1] + offset };
+        float* chunkOutputs[2] = { outputs[0] + offset, outputs[1] + offset };
+
+        _context->process((float**)chunkInputs, chunkOutputs, chunk);
+
+        if (_fadeState != kFadeIdle)
+        {
+            const uint32_t ramp = std::min(chunk, _fadeRemaining);
+
+            applyFade(outputs, offset, ramp, chunk);
+            _fadeRemaining -= ramp;
+
+            if (_fadeRemaining == 0 && _fadeState == kFadeOut)
+            {
+                _heldParameters = sendParameters(_heldParameters);
+                _fadeState = kFadeIn;
+                _fadeRemaining = _fadeFrames;
+            }
+            else if (_fadeRemaining == 0)
+            {
+                _fadeState = kFadeIdle;
+            }
+        }
+
+        offset += chunk;
+    }
+
+    if (silentInput && _silentFrames == _tailFrames && _fadeState == kFadeIdle && _heldParameters == 0)
+    {
+        _asleep = isSilentBlock(outputs[0], frames) && isSilentBlock(outputs[1], frames);
+
+        if (_asleep)
+            WSTD_TRACE_INSTANT("sleep", 0, 0.0f);
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Callbacks
+
+void HeavyDPF_WSTD_M3NGLR::sampleRateChanged(double newSampleRate)
+{
+    initContext(newSampleRate);
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+Plugin* createPlugin()
+{
+    return new HeavyDPF_WSTD_M3NGLR();
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
@@ -0,0 +1,184 @@
+/**
+ * Copyright (c) Wasted Audio 2023 - GPL-3.0-or-later
+ */
+
+#ifndef _HEAVY_DPF_WSTD_M3NGLR_
+#define _HEAVY_DPF_WSTD_M3NGLR_
+
+#include "DistrhoPlugin.hpp"
+#include "DistrhoPluginInfo.h"
+#include "HeavyDPF_WSTD_M3NGLR_Meta.hpp"
+#include "Heavy_WSTD_M3NGLR.hpp"
+#include "WstdTrace.hpp"
+#include <atomic>
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+
+class HeavyDPF_WSTD_M3NGLR : public Plugin
+{
+public:
+    enum Parameters
+    {
+        paramHigh,
+        paramHigh_Crshr,
+        paramHigh_Fldr,
+        paramHigh_Gain,
+        paramHigh_Lmtr,
+        paramHigh_Mix,
+        paramHigh_Smthr,
+        paramHigh_Sqnc,
+        paramLow,
+        paramLow_Crshr,
+        paramLow_Fldr,
+        paramLow_Gain,
+        paramLow_Lmtr,
+        paramLow_Mix,
+        paramLow_Smthr,
+        paramLow_Sqnc,
+        paramMid,
+        paramMid_Crshr,
+        paramMid_Fldr,
+        paramMid_Freq,
+        paramMid_Gain,
+        paramMid_Lmtr,
+        paramMid_Mix,
+        paramMid_Smthr,
+        paramMid_Sqnc,
+        paramCount
+    };
+
+    // factory programs, each hands a whole state over as one snapshot
+    enum Programs
+    {
+        programDefault,
+        programCount
+    };
+
+    HeavyDPF_WSTD_M3NGLR();
+    ~HeavyDPF_WSTD_M3NGLR() override;
+
+protected:
+    // ----------------------------------------------------------------------------------------------------------------
+    // Information
+
+    // everything but the maker comes from WSTD_M3NGLR.json, through the generated meta header
+
+    const char* getLabel() const noexcept override
+    {
+        return WSTD_META_LABEL;
+    }
+
+    const char* getMaker() const noexcept override
+    {
+        return DISTRHO_PLUGIN_BRAND;
+    }
+
+    const char* getHomePage() const override
+    {
+        return WSTD_META_HOMEPAGE;
+    }
+
+    const char* getLicense() const noexcept override
+    {
+        return WSTD_META_LICENSE;
+    }
+
+    uint32_t getVersion() const noexcept override
+    {
+        return d_version(WSTD_META_VERSION);
+    }
+
+    int64_t getUniqueId() const noexcept override
+    {
+        return d_cconst(WSTD_META_UNIQUE_ID);
+    }
+
+    // ----------------------------------------------------------------------------------------------------------------
+    // Init
+
+    void initParameter(uint32_t index, Parameter& parameter) override;
+    void initProgramName(uint32_t index, String& programName) override;
+
+    // ----------------------------------------------------------------------------------------------------------------
+    // Internal data
+
+    float getParameterValue(uint32_t index) const override;
+    void  setParameterValue(uint32_t index, float value) override;
+    void  loadProgram(uint32_t index) override;
+
+    // ----------------------------------------------------------------------------------------------------------------
+    // Process
+
+    void activate() override;
+    void deactivate() override;
+    void run(const float** inputs, float** outputs, uint32_t frames) override;
+
+    // ----------------------------------------------------------------------------------------------------------------
+    // Callbacks
+
+    void sampleRateChanged(double newSampleRate) override;
+
+    // ----------------------------------------------------------------------------------------------------------------
+
+private:
+    enum FadeState {
+        kFadeIdle,
+        kFadeOut,
+        kFadeIn,
+    };
+
+    void initContext(double sampleRate);
+    void printMemoryReport(double sampleRate) const;
+    void printUsageReport() const;
+    bool needsFade(uint32_t changed) const noexcept;
+    uint32_t sendParameters(uint32_t changed);
+    void applyFade(float** outputs, uint32_t offset, uint32_t ramp, uint32_t frames) noexcept;
+
+    // parameters, as set by the host and as last sent to the context
+    float _parameters[paramCount];
+    float _appliedParameters[paramCount];
+
+    // changes are collected as a bitmask and applied together at the next block
+    std::atomic<uint32_t> _pendingParameters { 0 };
+    uint32_t _heldParameters = 0;
+
+    // parameters the current context has not received yet, sent even if the value did not change
+    uint32_t _unsentParameters = 0;
+
+    // a loaded program, its changes are faded whatever they are
+    std::atomic<bool> _pendingSnapshot { false };
+    bool _heldSnapshot = false;
+
+    // short fade around discontinuous parameter changes
+    FadeState _fadeState = kFadeIdle;
+    uint32_t _fadeFrames = 0;
+    uint32_t _fadeRemaining = 0;
+
+    // silence detection, processing stops once the tail has decayed
+    uint32_t _tailFrames = 0;
+    uint32_t _silentFrames = 0;
+    bool _asleep = false;
+
+    // heavy context
+    HeavyContextInterface *_context;
+    int _poolKb;
+    int _inQueueKb;
+
+    // WSTD_M3NGLR_MEMREPORT, sizes and actual usage of each context
+    bool _memoryReport = false;
+    uint32_t _peakMessages = 0;
+    uint32_t _refusedMessages = 0;
+
+    // TRACE builds, events of run() and everything it calls
+    WSTD_TRACE_MEMBER
+
+    DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(HeavyDPF_WSTD_M3NGLR)
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+#endif // _HEAVY_DPF_WSTD_M3NGLR_
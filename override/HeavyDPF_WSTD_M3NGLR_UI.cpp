@@ -3,13 +3,17 @@
  */
 
 #include "DistrhoUI.hpp"
+#include "HeavyDPF_WSTD_M3NGLR_Meta.hpp"
 #ifdef DISTRHO_OS_WASM
 #include "DistrhoStandaloneUtils.hpp"
 #endif
 #include "ResizeHandle.hpp"
 #include "veramobd.hpp"
 #include "wstdcolors.hpp"
+#include "WstdTrace.hpp"
+#include <mutex>
 #include <tuple>
+#include <vector>
 
 
 START_NAMESPACE_DISTRHO
@@ -23,6 +27,83 @@ const char* comChar(const char* char1, const char* char2)
     return s;
 }
 
+// --------------------------------------------------------------------------------------------------------------------
+// Font atlas shared by all editor instances with the same scale factor
+// The lock also covers drawing: every editor sets its own texture on the shared atlas and ImGui locks the
+// atlas for the frame, so editors running on different UI threads must not draw at the same time.
+
+struct SharedFontAtlas {
+    double scaleFactor;
+    ImFontAtlas* atlas;
+    int refCount;
+};
+
+static std::mutex sFontAtlasMutex;
+static std::vector<SharedFontAtlas> sFontAtlases;
+
+ImFontAtlas* acquireFontAtlas(double scaleFactor)
+{
+    const std::lock_guard<std::mutex> lock(sFontAtlasMutex);
+
+    for (SharedFontAtlas& shared : sFontAtlases)
+    {
+        if (shared.scaleFactor == scaleFactor)
+        {
+            ++shared.refCount;
+            return shared.atlas;
+        }
+    }
+
+    // the UI only ever draws printable ASCII
+    static const ImWchar glyphRanges[] = { 0x0020, 0x007E, 0 };
+
+    ImFontAtlas* atlas = IM_NEW(ImFontAtlas)();
+    atlas->Flags |= ImFontAtlasFlags_NoMouseCursors;
+
+    ImFontConfig fc;
+    fc.OversampleH = 1;
+    fc.OversampleV = 1;
+    fc.PixelSnapH = true;
+
+    // decompress the TTF once, the other sizes reuse its data
+    atlas->AddFontFromMemoryCompressedTTF((void*)veramobd_compressed_data, veramobd_compressed_size, 16.0f * scaleFactor, &fc, glyphRanges);
+
+    fc.FontDataOwnedByAtlas = false;
+    void* fontData = atlas->ConfigData[0].FontData;
+    const int fontDataSize = atlas->ConfigData[0].FontDataSize;
+
+    atlas->AddFontFromMemoryTTF(fontData, fontDataSize, 21.0f * scaleFactor, &fc, glyphRanges);
+    atlas->AddFontFromMemoryTTF(fontData, fontDataSize, 11.0f * scaleFactor, &fc, glyphRanges);
+    atlas->AddFontFromMemoryTTF(fontData, fontDataSize, 12.5f * scaleFactor, &fc, glyphRanges);
+    atlas->Build();
+
+    // only the rasterized texture is needed from here on
+    atlas->ClearInputData();
+
+    sFontAtlases.push_back({scaleFactor, atlas, 1});
+    return atlas;
+}
+
+void releaseFontAtlas(double scaleFactor)
+{
+    const std::lock_guard<std::mutex> lock(sFontAtlasMutex);
+
+    for (auto it = sFontAtlases.begin(); it != sFontAtlases.end(); ++it)
+    {
+        if (it->scaleFactor == scaleFactor)
+        {
+            if (--it->refCount == 0)
+            {
+                IM_DELETE(it->atlas);
+                sFontAtlases.erase(it);
+            }
+            return;
+        }
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
 struct mangParams {
     int crshr;
     int fldr;
@@ -123,6 +204,14 @@ class ImGuiPluginUI : public UI
     float fmid_smthr = 1.0f;
     int fmid_sqnc = 0.0;
 
+    ImGuiIO* fIO;
+    ImFontAtlas* fContextFonts;
+    double fFontScaleFactor;
+    ImTextureID fFontTexID {};
+
+    // TRACE builds, events of this editor
+    WSTD_TRACE_MEMBER
+
     // ----------------------------------------------------------------------------------------------------------------
 
 public:
@@ -135,18 +224,28 @@ public:
     {
         ImGuiIO& io(ImGui::GetIO());
 
-        ImFontConfig fc;
-        fc.FontDataOwnedByAtlas = true;
-        fc.OversampleH = 1;
-        fc.OversampleV = 1;
-        fc.PixelSnapH = true;
-
-        io.Fonts->AddFontFromMemoryCompressedTTF((void*)veramobd_compressed_data, veramobd_compressed_size, 16.0f * getScaleFactor(), &fc);
-        io.Fonts->AddFontFromMemoryCompressedTTF((void*)veramobd_compressed_data, veramobd_compressed_size, 21.0f * getScaleFactor(), &fc);
-        io.Fonts->AddFontFromMemoryCompressedTTF((void*)veramobd_compressed_data, veramobd_compressed_size, 11.0f * getScaleFactor(), &fc);
-        io.Fonts->AddFontFromMemoryCompressedTTF((void*)veramobd_compressed_data, veramobd_compressed_size, 12.5f * getScaleFactor(), &fc);
-        io.Fonts->Build();
-        io.FontDefault = io.Fonts->Fonts[1];
+        // keep the context's own atlas aside, it is handed back before the context is destroyed
+        fIO = &io;
+        fContextFonts = io.Fonts;
+        fFontScaleFactor = getScaleFactor();
+
+        io.Fonts = acquireFontAtlas(fFontScaleFactor);
+        io.FontDefault = io.Fonts->Fonts[0];
+
+        // nothing is drawn from the context's atlas, free its fonts and texture data until it is handed back
+        fContextFonts->Clear();
+
+        WSTD_TRACE_INIT();
+        WSTD_TRACE_CLAIM();
+    }
+
+    ~ImGuiPluginUI() override
+    {
+        fIO->Fonts = fContextFonts;
+        fIO->FontDefault = nullptr;
+        releaseFontAtlas(fFontScaleFactor);
+
+        WSTD_TRACE_RELEASE();
     }
 
 protected:
@@ -242,6 +341,18 @@ protected:
         repaint();
     }
 
+   /**
+      A program has been loaded on the plugin side.@n
+      The only program is the default state, show the parameter defaults.
+    */
+    void programLoaded(uint32_t) override
+    {
+        static const float defaults[] = { WSTD_META_DEFAULTS };
+
+        for (uint32_t i = 0; i < sizeof(defaults) / sizeof(defaults[0]); ++i)
+            parameterChanged(i, defaults[i]);
+    }
+
     // ----------------------------------------------------------------------------------------------------------------
     // Widget Callbacks
 
@@ -546,11 +657,27 @@ protected:
         );
     }
 
+   /**
+      Draws the frame with the shared font atlas.
+      The atlas is shared, but every editor uploads it into its own GL context, so our texture
+      is put back before ImGui starts the frame and uses the atlas.
+    */
+    void onDisplay() override
+    {
+        const std::lock_guard<std::mutex> lock(sFontAtlasMutex);
+
+        if (fFontTexID != ImTextureID())
+            fIO->Fonts->SetTexID(fFontTexID);
+
+        UI::onDisplay();
+    }
+
    /**
       ImGui specific onDisplay function.
     */
     void onImGuiDisplay() override
     {
+        WSTD_TRACE_SCOPE("display", 0);
 
         const float width  = getWidth();
         const float height = getHeight();
@@ -571,10 +698,15 @@ protected:
         style.Colors[ImGuiCol_WindowBg]      = (ImVec4)WstdWindowBg;
 
         ImGuiIO& io(ImGui::GetIO());
+
+        // the backend uploads the atlas on the first frame, keep the texture it made for this context
+        if (fFontTexID == ImTextureID())
+            fFontTexID = io.Fonts->TexID;
+
         ImFont* defaultFont  = ImGui::GetFont();
-        ImFont* titleBarFont = io.Fonts->Fonts[2];
-        ImFont* smallFont    = io.Fonts->Fonts[3];
-        ImFont* mediumFont   = io.Fonts->Fonts[4];
+        ImFont* titleBarFont = io.Fonts->Fonts[1];
+        ImFont* smallFont    = io.Fonts->Fonts[2];
+        ImFont* mediumFont   = io.Fonts->Fonts[3];
 
         // Colors
         auto HighColorActive     = ColorBright(Blue,   fhigh);
@@ -602,6 +734,11 @@ protected:
         auto dbstep   = 0.1f;
         auto hzstep   = 20.0f;
 
+        #ifdef WSTD_M3NGLR_TRACE
+        if (io.KeyCtrl && io.KeyShift && ImGui::IsKeyPressed(ImGuiKey_T, false))
+            WSTD_TRACE_DUMP("ui");
+        #endif
+
         if (io.KeyShift)
         {
             crshstep = 1;
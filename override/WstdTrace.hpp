@@ -0,0 +1,337 @@
+/**
+ * Copyright (c) Wasted Audio 2023 - GPL-3.0-or-later
+ */
+
+#ifndef _WSTD_TRACE_
+#define _WSTD_TRACE_
+
+/**
+   Event tracer for finding dropouts, built with `make TRACE=true`.
+
+   Events go into fixed-size ring buffers, recording never locks, allocates or prints.
+   Rings are claimed and handed back explicitly, outside the audio thread: a plugin instance holds one
+   from activate() to deactivate() for everything its run() records, an editor holds one while it is open.
+   Each ring has a single writer at a time and shows up as its own track. Instances that find all
+   WSTD_TRACE_RINGS rings taken record nothing and are counted.
+
+   The rings are written out as Chrome trace JSON (chrome://tracing, ui.perfetto.dev) on WSTD_TRACE_DUMP(),
+   each time the trigger file `wstd_m3nglr.dump` is touched (polled from a background thread, not on Windows),
+   and at process exit. Hosts generally do not get to unload the binary before that, glibc keeps it loaded
+   because of the tracer's own statics. Files and trigger go in $WSTD_M3NGLR_TRACE_DIR, or /tmp.
+   Timestamps are steady clock time and pids are real, so traces of the DSP and UI binaries of lv2_sep
+   builds, or of several processes, line up when loaded together.
+
+   The macros are meant for plugin and UI member functions, events are tagged with `this`.
+   Without TRACE they compile to nothing.
+*/
+#include "WstdConfig.hpp"
+
+#ifdef WSTD_M3NGLR_TRACE
+
+#include "DistrhoUtils.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#endif
+
+// events kept per ring, oldest ones are overwritten
+#ifndef WSTD_TRACE_RING_SIZE
+#define WSTD_TRACE_RING_SIZE 8192
+#endif
+
+// rings that can be held at the same time, set with `make TRACE=true TRACE_RINGS=64`
+#ifndef WSTD_TRACE_RINGS
+#define WSTD_TRACE_RINGS 32
+#endif
+
+// how often the trigger file is checked, in milliseconds
+#define WSTD_TRACE_POLL_TIME 250
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+
+struct WstdTraceEvent {
+    uint64_t time;
+    const char* name;
+    const void* instance;
+    uint32_t arg;
+    float value;
+    char phase;
+};
+
+struct WstdTraceRing {
+    std::atomic<bool> used;
+    std::atomic<uint64_t> written;
+    WstdTraceEvent events[WSTD_TRACE_RING_SIZE];
+};
+
+class WstdTracer
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    WstdTracer()
+        : fDir(std::getenv("WSTD_M3NGLR_TRACE_DIR") != nullptr ? std::getenv("WSTD_M3NGLR_TRACE_DIR") : "/tmp"),
+          fUntraced(0)
+    {
+#ifndef _WIN32
+        fTriggerPath = fDir + "/wstd_m3nglr.dump";
+        fTriggerTime = getTriggerTime();
+        fQuit = false;
+        fPoller = std::thread(&WstdTracer::poll, this);
+#endif
+    }
+
+    ~WstdTracer()
+    {
+#ifndef _WIN32
+        {
+            const std::lock_guard<std::mutex> lock(fPollMutex);
+            fQuit = true;
+        }
+        fPollCondition.notify_one();
+        fPoller.join();
+#endif
+        dump("exit");
+    }
+
+    // not for the audio thread, returns nullptr when every ring is taken
+    WstdTraceRing* claim()
+    {
+        for (uint32_t r = 0; r < WSTD_TRACE_RINGS; ++r)
+        {
+            bool used = false;
+
+            if (fRings[r].used.compare_exchange_strong(used, true, std::memory_order_acquire))
+                return &fRings[r];
+        }
+
+        if (fUntraced.fetch_add(1) == 0)
+            d_stderr("WSTD_M3NGLR: all %d trace rings are taken, raise WSTD_TRACE_RINGS", WSTD_TRACE_RINGS);
+
+        return nullptr;
+    }
+
+    void release(WstdTraceRing*& ring) noexcept
+    {
+        if (ring != nullptr)
+            ring->used.store(false, std::memory_order_release);
+
+        ring = nullptr;
+    }
+
+    // only ever called by the current holder of the ring
+    void record(WstdTraceRing* ring, char phase, const char* name, const void* instance, uint32_t arg, float value) noexcept
+    {
+        if (ring == nullptr)
+            return;
+
+        const uint64_t n = ring->written.load(std::memory_order_relaxed);
+        WstdTraceEvent& event(ring->events[n % WSTD_TRACE_RING_SIZE]);
+
+        event.time     = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+        event.name     = name;
+        event.instance = instance;
+        event.arg      = arg;
+        event.value    = value;
+        event.phase    = phase;
+
+        ring->written.store(n + 1, std::memory_order_release);
+    }
+
+    void dump(const char* tag)
+    {
+        const int pid = getProcessId();
+        const long long stamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+
+        // the DSP and UI binaries of one process each have a tracer, the address tells them apart
+        char path[1024];
+        std::snprintf(path, sizeof(path), "%s/wstd_m3nglr-%d-%s-%lld-%p.json",
+                      fDir.c_str(), pid, tag, stamp, static_cast<void*>(this));
+
+        FILE* const f = std::fopen(path, "w");
+        if (f == nullptr)
+        {
+            d_stderr("WSTD_M3NGLR: could not write trace to %s", path);
+            return;
+        }
+
+        const uint64_t untraced = fUntraced.load();
+
+        std::fprintf(f, "{\"untracedInstances\":%llu,\"traceEvents\":[\n", static_cast<unsigned long long>(untraced));
+        std::fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"WSTD_M3NGLR\"}}", pid);
+
+        std::vector<WstdTraceEvent> events;
+        events.reserve(WSTD_TRACE_RING_SIZE);
+
+        for (uint32_t r = 0; r < WSTD_TRACE_RINGS; ++r)
+        {
+            const WstdTraceRing& ring(fRings[r]);
+
+            // The holder keeps writing while we copy. Whatever it overwrote in the meantime,
+            // and the slot it may be writing now, is dropped.
+            const uint64_t before = ring.written.load(std::memory_order_acquire);
+            const uint64_t first = before > WSTD_TRACE_RING_SIZE ? before - WSTD_TRACE_RING_SIZE : 0;
+
+            events.clear();
+            for (uint64_t n = first; n < before; ++n)
+                events.push_back(ring.events[n % WSTD_TRACE_RING_SIZE]);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint64_t after = ring.written.load(std::memory_order_relaxed);
+            const uint64_t valid = after >= WSTD_TRACE_RING_SIZE ? after - WSTD_TRACE_RING_SIZE + 1 : 0;
+
+            for (uint64_t n = std::max(first, valid); n < before; ++n)
+            {
+                const WstdTraceEvent& event(events[n - first]);
+
+                std::fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u",
+                             event.name, event.phase, event.time / 1000.0, pid, r + 1);
+
+                if (event.phase == 'i')
+                {
+                    // JSON has no nan or inf, those go in as strings
+                    std::fprintf(f, std::isfinite(event.value)
+                                    ? ",\"s\":\"t\",\"args\":{\"instance\":\"%p\",\"arg\":%u,\"value\":%g}}"
+                                    : ",\"s\":\"t\",\"args\":{\"instance\":\"%p\",\"arg\":%u,\"value\":\"%g\"}}",
+                                 event.instance, event.arg, event.value);
+                }
+                else if (event.phase == 'B')
+                    std::fprintf(f, ",\"args\":{\"instance\":\"%p\",\"arg\":%u}}", event.instance, event.arg);
+                else
+                    std::fputs("}", f);
+            }
+        }
+
+        std::fputs("\n]}\n", f);
+        std::fclose(f);
+
+        d_stdout("WSTD_M3NGLR: trace written to %s", path);
+    }
+
+private:
+    static int getProcessId() noexcept
+    {
+#ifdef _WIN32
+        return _getpid();
+#else
+        return getpid();
+#endif
+    }
+
+#ifndef _WIN32
+    long long getTriggerTime() const noexcept
+    {
+        struct stat st;
+        return stat(fTriggerPath.c_str(), &st) == 0 ? static_cast<long long>(st.st_mtime) : 0;
+    }
+
+    // Dumps whenever the trigger file is touched. Every tracer of the process, and of every other
+    // process writing to the same directory, notices the same touch.
+    void poll()
+    {
+        std::unique_lock<std::mutex> lock(fPollMutex);
+
+        while (! fPollCondition.wait_for(lock, std::chrono::milliseconds(WSTD_TRACE_POLL_TIME), [this] { return fQuit; }))
+        {
+            const long long triggerTime = getTriggerTime();
+
+            if (triggerTime != 0 && triggerTime != fTriggerTime)
+            {
+                fTriggerTime = triggerTime;
+                dump("request");
+            }
+        }
+    }
+
+    std::string fTriggerPath;
+    long long fTriggerTime;
+    bool fQuit;
+    std::mutex fPollMutex;
+    std::condition_variable fPollCondition;
+    std::thread fPoller;
+#endif
+
+    const std::string fDir;
+    std::atomic<uint64_t> fUntraced;
+    WstdTraceRing fRings[WSTD_TRACE_RINGS] = {};
+};
+
+inline WstdTracer& wstdTracer()
+{
+    static WstdTracer tracer;
+    return tracer;
+}
+
+struct WstdTraceScope {
+    WstdTraceRing* const ring;
+    const char* const name;
+    const void* const instance;
+
+    WstdTraceScope(WstdTraceRing* r, const char* n, const void* i, uint32_t arg) noexcept
+        : ring(r),
+          name(n),
+          instance(i)
+    {
+        wstdTracer().record(ring, 'B', name, instance, arg, 0.0f);
+    }
+
+    ~WstdTraceScope() noexcept
+    {
+        wstdTracer().record(ring, 'E', name, instance, 0, 0.0f);
+    }
+};
+
+inline void wstdTraceDump(const char* tag)
+{
+    wstdTracer().dump(tag);
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+#define WSTD_TRACE_CONCAT_(a, b) a ## b
+#define WSTD_TRACE_CONCAT(a, b) WSTD_TRACE_CONCAT_(a, b)
+
+// the ring of a plugin or UI instance, declared among its members
+#define WSTD_TRACE_MEMBER WstdTraceRing* _wstdTraceRing = nullptr;
+
+// call from a constructor, so the tracer and its trigger poller do not start on the audio thread
+#define WSTD_TRACE_INIT() ((void)wstdTracer())
+// claim and hand back the instance's ring, never on the audio thread
+#define WSTD_TRACE_CLAIM() (_wstdTraceRing = wstdTracer().claim())
+#define WSTD_TRACE_RELEASE() wstdTracer().release(_wstdTraceRing)
+#define WSTD_TRACE_SCOPE(name, arg) const WstdTraceScope WSTD_TRACE_CONCAT(_wstdTrace, __LINE__)(_wstdTraceRing, name, this, arg)
+#define WSTD_TRACE_INSTANT(name, arg, value) wstdTracer().record(_wstdTraceRing, 'i', name, this, arg, value)
+#define WSTD_TRACE_DUMP(tag) wstdTraceDump(tag)
+
+#else
+
+#define WSTD_TRACE_MEMBER
+#define WSTD_TRACE_INIT() ((void)0)
+#define WSTD_TRACE_CLAIM() ((void)0)
+#define WSTD_TRACE_RELEASE() ((void)0)
+#define WSTD_TRACE_SCOPE(name, arg) ((void)0)
+#define WSTD_TRACE_INSTANT(name, arg, value) ((void)0)
+#define WSTD_TRACE_DUMP(tag) ((void)0)
+
+#endif // WSTD_M3NGLR_TRACE
+
+#endif // _WSTD_TRACE_
@@ -0,0 +1,215 @@
+#!/usr/bin/env python3
+# Copyright (c) Wasted Audio 2023 - GPL-3.0-or-later
+#
+# The DSP wrapper in override/ replaces the one hvcc generates. This script keeps the two in step:
+#  - it writes HeavyDPF_<name>_Meta.hpp with the plugin metadata from the hvcc JSON and the
+#    parameter table from the @hv_param receivers in the patch, so nothing is typed twice
+#  - it compares the generated wrapper, the parameter enum in the override header and that metadata,
+#    and fails if any of them diverge
+#  - it enables DPF programs in the generated DistrhoPluginInfo.h, the wrapper loads them as snapshots
+#  - it lists the objects of the generated Heavy context, for the per-object memory report
+#
+# usage: plugin_meta.py <name>.json <name>.pd <plugin/source dir>
+# Run after hvcc and before override/ is copied over the generated sources.
+
+import json
+import os
+import re
+import sys
+
+
+def fail(message):
+    sys.exit("plugin_meta.py: " + message)
+
+
+def c_float(value):
+    return repr(float(value)) + "f"
+
+
+def read_parameters(pd_path):
+    params = []
+    with open(pd_path) as f:
+        for match in re.finditer(r"\br (\w+) @hv_param ([^;,]*)", f.read()):
+            args = match.group(2).split()
+            if len(args) < 3:
+                fail("%s: @hv_param %s needs min, max and default" % (pd_path, match.group(1)))
+            params.append({
+                "name": match.group(1),
+                "min": float(args[0]),
+                "max": float(args[1]),
+                "def": float(args[2]),
+                "type": args[3] if len(args) > 3 else "",
+            })
+    # hvcc sorts the receivers by name
+    return sorted(params, key=lambda p: p["name"])
+
+
+def parameter_unit_hints(param):
+    # same mapping as the hvcc DPF template
+    kind = param["type"]
+    if kind == "db":
+        return "dB", "0"
+    if kind == "log_hz":
+        return "Hz", "kParameterIsLogarithmic"
+    if kind == "log":
+        return "", "kParameterIsLogarithmic"
+    if kind == "int":
+        return "", "kParameterIsInteger"
+    if kind == "bool":
+        return "", "kParameterIsBoolean"
+    if kind:
+        fail("unknown @hv_param type '%s' on %s" % (kind, param["name"]))
+    return "", "0"
+
+
+def check_generated(path, meta, params):
+    if not os.path.exists(path):
+        fail("%s not found, run hvcc first" % path)
+    with open(path) as f:
+        source = f.read()
+    flat = re.sub(r"\s+", "", source)
+    dpf = meta["dpf"]
+
+    receivers = sorted(set(re.findall(r"Parameter::In::(\w+)", source)))
+    expected = sorted(p["name"].upper() for p in params)
+    if receivers != expected:
+        fail("receivers in %s differ from the patch: %s" % (path, ", ".join(sorted(set(receivers) ^ set(expected)))))
+
+    ranges = [float(v) for v in re.findall(r"parameter\.ranges\.(?:min|max|def)=(-?[\d.]+)f?;", flat)]
+    expected = [v for p in params for v in (p["min"], p["max"], p["def"])]
+    if ranges != expected:
+        fail("parameter ranges in %s differ from the patch" % path)
+
+    units = sorted(u for u in re.findall(r'parameter\.unit="([^"]*)";', flat) if u)
+    expected = sorted(u for u in (parameter_unit_hints(p)[0] for p in params) if u)
+    if units != expected:
+        fail("parameter units in %s differ from the patch: %s vs %s" % (path, units, expected))
+
+    for snippet in ('"%s"' % meta["name"],
+                    '"%s"' % dpf["homepage"],
+                    '"%s"' % dpf["license"],
+                    "d_version(%s)" % dpf["version"].replace(" ", ""),
+                    "d_cconst(%s)" % ",".join("'%s'" % c for c in dpf["unique_id"])):
+        if snippet not in flat:
+            fail("%s not found in %s" % (snippet, path))
+
+    if ("ScopedDenormalDisable" in source) != (dpf.get("denormals", True) is False):
+        fail("denormal handling in %s does not follow the JSON" % path)
+
+
+def check_override(path, params):
+    with open(path) as f:
+        names = re.findall(r"^\s*param(\w+),\s*$", f.read(), re.MULTILINE)
+    expected = [p["name"] for p in params]
+    if names != expected:
+        fail("parameter enum in %s differs from the patch receivers" % path)
+
+
+def check_enumerators(meta, params):
+    names = set(p["name"] for p in params)
+    enumerators = meta["dpf"].get("enumerators", {})
+    for key in enumerators:
+        if key not in names:
+            fail("enumerator %s has no matching receiver in the patch" % key)
+    # the wrapper shares one label list between the three band sequences
+    if len(set(tuple(v) for k, v in enumerators.items() if k.endswith("_Sqnc"))) > 1:
+        fail("the _Sqnc enumerators differ, the wrapper expects one shared list")
+
+
+def enable_programs(path):
+    if not os.path.exists(path):
+        fail("%s not found, run hvcc first" % path)
+    with open(path) as f:
+        source = f.read()
+    define = "#define DISTRHO_PLUGIN_WANT_PROGRAMS 1"
+    source, count = re.subn(r"#define DISTRHO_PLUGIN_WANT_PROGRAMS\b.*", define, source)
+    if count == 0:
+        end = source.rfind("#endif")
+        if end < 0:
+            fail("no include guard found in %s" % path)
+        source = source[:end] + define + "\n\n" + source[end:]
+    with open(path, "w") as f:
+        f.write(source)
+
+
+def read_objects(path):
+    if not os.path.exists(path):
+        fail("%s not found, run hvcc first" % path)
+    with open(path) as f:
+        objects = re.findall(r"^\s+((?:Signal|Control|Hv)\w+)\s+(\w+);\s*$", f.read(), re.MULTILINE)
+    if not objects:
+        fail("no objects found in %s" % path)
+    return objects
+
+
+def write_meta(path, meta, params, objects):
+    dpf = meta["dpf"]
+    name = meta["name"]
+
+    lines = [
+        "// Generated by tools/plugin_meta.py from %s.json and %s.pd, do not edit." % (name, name),
+        "",
+        "#ifndef _HEAVY_DPF_%s_META_" % name,
+        "#define _HEAVY_DPF_%s_META_" % name,
+        "",
+        '#define WSTD_META_LABEL "%s"' % name,
+        '#define WSTD_META_HOMEPAGE "%s"' % dpf["homepage"],
+        '#define WSTD_META_LICENSE "%s"' % dpf["license"],
+        "#define WSTD_META_VERSION %s" % dpf["version"],
+        "#define WSTD_META_UNIQUE_ID %s" % ", ".join("'%s'" % c for c in dpf["unique_id"]),
+        "#define WSTD_META_DISABLE_DENORMALS %d" % (dpf.get("denormals", True) is False),
+        "",
+        "// name, symbol, unit, hints, min, max, default",
+        "#define WSTD_META_PARAMETERS \\",
+    ]
+    for p in params:
+        unit, hints = parameter_unit_hints(p)
+        lines.append('    { "%s", "%s", "%s", %s, %s, %s, %s }, \\' % (
+            p["name"].replace("_", " "), p["name"].lower(), unit, hints,
+            c_float(p["min"]), c_float(p["max"]), c_float(p["def"])))
+    lines.append("")
+    lines.append("#define WSTD_META_DEFAULTS \\")
+    for p in params:
+        lines.append("    %s, \\" % c_float(p["def"]))
+    lines.append("")
+    lines.append("#define WSTD_META_RECEIVERS \\")
+    for p in params:
+        lines.append("    Heavy_%s::Parameter::In::%s, \\" % (name, p["name"].upper()))
+    lines.append("")
+
+    lines.append("// name, type, size of every object in the Heavy context")
+    lines.append("#define WSTD_META_OBJECTS \\")
+    for kind, member in objects:
+        lines.append('    { "%s", "%s", sizeof(%s) }, \\' % (member, kind, kind))
+    lines.append("")
+
+    for key, values in sorted(dpf.get("enumerators", {}).items()):
+        lines.append("#define WSTD_META_ENUM_%s %s" % (key, ", ".join('"%s"' % v for v in values)))
+        lines.append("#define WSTD_META_ENUM_%s_COUNT %d" % (key, len(values)))
+    lines.append("")
+    lines.append("#endif // _HEAVY_DPF_%s_META_" % name)
+
+    with open(path, "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+
+def main():
+    if len(sys.argv) != 4:
+        sys.exit("usage: %s <name>.json <name>.pd <plugin/source dir>" % sys.argv[0])
+
+    with open(sys.argv[1]) as f:
+        meta = json.load(f)
+    params = read_parameters(sys.argv[2])
+    name = meta["name"]
+    source_dir = sys.argv[3]
+
+    check_generated(os.path.join(source_dir, "HeavyDPF_%s.cpp" % name), meta, params)
+    check_override(os.path.join("override", "HeavyDPF_%s.hpp" % name), params)
+    check_enumerators(meta, params)
+    enable_programs(os.path.join(source_dir, "DistrhoPluginInfo.h"))
+    objects = read_objects(os.path.join(source_dir, "Heavy_%s.hpp" % name))
+    write_meta(os.path.join(source_dir, "HeavyDPF_%s_Meta.hpp" % name), meta, params, objects)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,180 @@
+/**
+ * Copyright (c) Wasted Audio 2023 - GPL-3.0-or-later
+ */
+
+// Measures how long a host needs to load a CLAP binary and bring up one running instance.
+// Each binary is measured in a fresh child process, so libraries another binary pulled in do not
+// make it look faster. The first run still reads from the page cache if the binary was used before.
+// usage: startup_bench <plugin.clap> [<plugin.clap> ...]
+
+#include "clap/entry.h"
+#include "clap/host.h"
+#include "clap/plugin-factory.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <dlfcn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+
+#define BENCH_RUNS 50
+
+typedef std::chrono::steady_clock Clock;
+
+
+static const void* getExtension(const clap_host_t*, const char*) { return nullptr; }
+static void requestRestart(const clap_host_t*) {}
+static void requestProcess(const clap_host_t*) {}
+static void requestCallback(const clap_host_t*) {}
+
+static const clap_host_t kHost = {
+    CLAP_VERSION,
+    nullptr,
+    "startup_bench",
+    "Wasted Audio",
+    "https://wasted.audio",
+    "1.0.0",
+    getExtension,
+    requestRestart,
+    requestProcess,
+    requestCallback,
+};
+
+struct Timings {
+    double load;
+    double instantiate;
+};
+
+static double elapsedMs(Clock::time_point start, Clock::time_point end)
+{
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static bool runOnce(const char* path, Timings& timings)
+{
+    const Clock::time_point start = Clock::now();
+
+    void* const lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (lib == nullptr)
+    {
+        fprintf(stderr, "%s\n", dlerror());
+        return false;
+    }
+
+    const clap_plugin_entry_t* const entry = (const clap_plugin_entry_t*)dlsym(lib, "clap_entry");
+    if (entry == nullptr || ! entry->init(path))
+    {
+        fprintf(stderr, "%s: no usable clap_entry\n", path);
+        dlclose(lib);
+        return false;
+    }
+
+    const Clock::time_point loaded = Clock::now();
+
+    const clap_plugin_factory_t* const factory = (const clap_plugin_factory_t*)entry->get_factory(CLAP_PLUGIN_FACTORY_ID);
+    const clap_plugin_descriptor_t* const descriptor = factory != nullptr && factory->get_plugin_count(factory) != 0
+                                                     ? factory->get_plugin_descriptor(factory, 0)
+                                                     : nullptr;
+    if (descriptor == nullptr)
+    {
+        fprintf(stderr, "%s: no plugin in the factory\n", path);
+        entry->deinit();
+        dlclose(lib);
+        return false;
+    }
+
+    const clap_plugin_t* const plugin = factory->create_plugin(factory, &kHost, descriptor->id);
+
+    const bool ok = plugin != nullptr && plugin->init(plugin) && plugin->activate(plugin, 48000.0, 32, 512);
+
+    const Clock::time_point instantiated = Clock::now();
+
+    if (plugin != nullptr)
+    {
+        if (ok)
+            plugin->deactivate(plugin);
+        plugin->destroy(plugin);
+    }
+
+    entry->deinit();
+    dlclose(lib);
+
+    timings.load = elapsedMs(start, loaded);
+    timings.instantiate = elapsedMs(loaded, instantiated);
+
+    if (! ok)
+        fprintf(stderr, "%s: failed to instantiate\n", path);
+
+    return ok;
+}
+
+static double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+static int bench(const char* path)
+{
+    Timings first;
+    std::vector<double> loads, instantiates;
+
+    // the first run in the process pays for mapping and relocating the binary and its libraries
+    if (! runOnce(path, first))
+        return 1;
+
+    for (int r = 0; r < BENCH_RUNS; ++r)
+    {
+        Timings warm;
+
+        if (! runOnce(path, warm))
+            return 1;
+
+        loads.push_back(warm.load);
+        instantiates.push_back(warm.instantiate);
+    }
+
+    printf("%-40s %9.3f ms %9.3f ms %9.3f ms %9.3f ms\n",
+           path, first.load, first.instantiate, median(loads), median(instantiates));
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <plugin.clap> [<plugin.clap> ...]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-40s %12s %12s %12s %12s\n", "", "first load", "first inst", "warm load", "warm inst");
+
+    for (int i = 1; i < argc; ++i)
+    {
+        fflush(stdout);
+
+        const pid_t pid = fork();
+        if (pid < 0)
+        {
+            perror("fork");
+            return 1;
+        }
+
+        if (pid == 0)
+        {
+            const int result = bench(argv[i]);
+            fflush(stdout);
+            _exit(result);
+        }
+
+        int status = 0;
+        if (waitpid(pid, &status, 0) != pid || ! WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            return 1;
+    }
+
+    return 0;
+}